@@ -0,0 +1,117 @@
+// Mixer throughput for stereo, 5.1 and 7.1 output.
+// Build inside engine tree as single translation unit together with engine's libs (SDL2, stb_vorbis), e.g.:
+//   g++ -O2 -std=c++11 sound_mixer_bench.cpp -lSDL2 -o sound_mixer_bench
+// Runs on SDL's dummy audio driver, so no audio hardware is needed.
+
+#define GENG_GAME_IMPL
+#include "grynca_common.h"
+#include "../sound_player.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+using namespace grynca;
+
+#define BENCH_VOICES (32)
+#define BENCH_BLOCKS (20000)
+#define BENCH_SOUND_FRAMES (44100)
+
+static void makeSound_(Sound* snd, u32 sound_id, u8 channels, u16 bitdepth, u32 sample_rate) {
+    u32 frame_size = channels * (bitdepth / 8);
+    u8* data = (u8*)malloc(BENCH_SOUND_FRAMES * frame_size);
+    for (u32 i = 0; i < BENCH_SOUND_FRAMES; ++i) {
+        double v = sin(i * 0.05) * 0.5;
+        for (u32 c = 0; c < channels; ++c) {
+            if (bitdepth == 16) {
+                ((i16*)data)[i * channels + c] = (i16)(v * 32767);
+            }
+            else {
+                data[i * channels + c] = (u8)(128 + v * 127);
+            }
+        }
+    }
+    snd->sound_id = sound_id;
+    snd->type = SND_TP_WAV;
+    snd->channels = channels;
+    snd->bitdepth = bitdepth;
+    snd->sample_rate = sample_rate;
+    snd->length = BENCH_SOUND_FRAMES;
+    snd->udata = data;
+    snd->udataSize = BENCH_SOUND_FRAMES * frame_size;
+    snd->udata_offset = 0;
+    snd->loop_start = 0;
+    snd->loop_end = BENCH_SOUND_FRAMES;
+}
+
+static bool bench_(u32 channels, const Sound* sounds, u32 sounds_count) {
+    SoundPlayer player(NULL);
+    if (!player.init(channels, SND_MIX_MODE_PULL)) {
+        return false;
+    }
+    player.reserveVoices(BENCH_VOICES);
+
+    // spreads voices over all output channels, so multichannel runs do not stay on front pair
+    double gains[SND_MAX_CHANNELS * 2];
+    for (u32 v = 0; v < BENCH_VOICES; ++v) {
+        const Sound* snd = &sounds[v % sounds_count];
+        SoundConfig cfg = { true, 0.5, player.getSampleRate() };
+        SoundInstance* inst = player.accSoundManager().getSound(snd, cfg);
+        if (!inst) {
+            continue;
+        }
+        if (channels != SND_CHANNELS_STEREO) {
+            for (u32 c = 0; c < channels; ++c) {
+                gains[c * 2] = (c % 2 == 0) ? (double)(c + v) / (channels + BENCH_VOICES) : 0.;
+                gains[c * 2 + 1] = (c % 2 == 1) ? (double)(c + v) / (channels + BENCH_VOICES) : 0.;
+            }
+            Index id = inst->getIndex();
+            player.setPanMatrix(id, gains);
+        }
+    }
+
+    const u32 frames = MIXER_BUFFER_SIZE / 2;
+    i16* out = (i16*)malloc(frames * channels * sizeof(i16));
+    // warm-up
+    for (u32 i = 0; i < 100; ++i) {
+        player.mix(out, frames);
+    }
+    std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+    for (u32 i = 0; i < BENCH_BLOCKS; ++i) {
+        player.mix(out, frames);
+    }
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+    free(out);
+
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double audio_ms = (double)BENCH_BLOCKS * frames * 1000. / player.getSampleRate();
+    printf("channels %u: %u voices, %.2f ms for %.0f ms of audio (%.1fx realtime, %.3f us/block)\n",
+           channels, BENCH_VOICES, ms, audio_ms, audio_ms / ms, ms * 1000. / BENCH_BLOCKS);
+
+    player.deinit();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+
+    // 16-bit stereo at device rate takes direct path, 8-bit mono at other rate takes resampling ring buffer path
+    Sound sounds[2];
+    makeSound_(&sounds[0], 0, 2, 16, BASE_AUDIO_FREQUENCY);
+    makeSound_(&sounds[1], 1, 1, 8, 22050);
+
+    const u32 layouts[] = { SND_CHANNELS_STEREO, SND_CHANNELS_5_1, SND_CHANNELS_7_1 };
+    int rslt = 0;
+    for (u32 i = 0; i < sizeof(layouts) / sizeof(layouts[0]); ++i) {
+        if (!bench_(layouts[i], sounds, 2)) {
+            printf("channels %u: init failed\n", layouts[i]);
+            rslt = 1;
+        }
+    }
+
+    for (u32 i = 0; i < 2; ++i) {
+        free(sounds[i].udata);
+    }
+    SDL_Quit();
+    return rslt;
+}
@@ -0,0 +1,191 @@
+#include "sound_bake.h"
+#include "grynca_common.h"
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace grynca {
+
+#define SND_BAKE_PI (3.14159265358979323846)
+
+    bool SoundBaker::bake(const Sound* snd, u32 sample_rate, Sound* baked) {
+        baked->clear();
+        float* src = decode_(snd);
+        if (!src) {
+            return false;
+        }
+
+        u32 dst_frames = (u32)(((u64)snd->length * sample_rate) / snd->sample_rate);
+        i16* dst = (i16*)malloc(max(dst_frames, (u32)1) * 2 * sizeof(i16));
+        if (!dst) {
+            PERR("SoundBaker::bake - could not allocate baked data.\n");
+            free(src);
+            return false;
+        }
+        resample_(src, snd->length, snd->sample_rate, dst, dst_frames, sample_rate);
+        free(src);
+
+        baked->sound_id = snd->sound_id;
+        baked->type = SND_TP_WAV;
+        baked->channels = 2;
+        baked->bitdepth = 16;
+        baked->sample_rate = sample_rate;
+        baked->length = dst_frames;
+        baked->udata = dst;
+        baked->udataSize = dst_frames * 2 * sizeof(i16);
+        baked->udata_offset = 0;
+        if (snd->loop_start < snd->loop_end && snd->loop_end <= snd->length) {
+            baked->loop_start = (u32)(((u64)snd->loop_start * sample_rate) / snd->sample_rate);
+            baked->loop_end = min((u32)(((u64)snd->loop_end * sample_rate) / snd->sample_rate), dst_frames);
+        }
+        else {
+            baked->loop_start = 0;
+            baked->loop_end = dst_frames;
+        }
+        return true;
+    }
+
+    u32 SoundBaker::bakeParallel(const Sound** snds, Sound* baked, u32 count, u32 sample_rate) {
+        std::atomic<u32> next(0);
+        std::atomic<u32> done(0);
+        // warm kernel table before workers start
+        kernel_();
+
+        u32 workers_count = min(max(std::thread::hardware_concurrency(), 1u), count);
+        std::vector<std::thread> workers;
+        for (u32 w = 0; w < workers_count; ++w) {
+            workers.push_back(std::thread([&]() {
+                for (u32 i = next++; i < count; i = next++) {
+                    if (bake(snds[i], sample_rate, &baked[i])) {
+                        done++;
+                    }
+                }
+            }));
+        }
+        for (u32 w = 0; w < workers.size(); ++w) {
+            workers[w].join();
+        }
+        return done;
+    }
+
+    void SoundBaker::clearBaked(Sound* baked) {
+        free(baked->udata);
+        baked->clear();
+    }
+
+    float* SoundBaker::decode_(const Sound* snd) {
+        float* out = (float*)malloc(max(snd->length, (u32)1) * 2 * sizeof(float));
+        if (!out) {
+            PERR("SoundBaker::decode_ - could not allocate decode buffer.\n");
+            return NULL;
+        }
+
+        switch (snd->type) {
+            case SND_TP_WAV: {
+                const u8* data = (const u8*)snd->udata + snd->udata_offset;
+                for (u32 i = 0; i < snd->length; i++) {
+                    float l, r;
+                    if (snd->bitdepth == 16) {
+                        const i16* p = (const i16*)data + i * snd->channels;
+                        l = p[0];
+                        r = p[snd->channels - 1];
+                    }
+                    else {
+                        const u8* p = data + i * snd->channels;
+                        l = (float)((p[0] - 128) << 8);
+                        r = (float)((p[snd->channels - 1] - 128) << 8);
+                    }
+                    out[i * 2] = l;
+                    out[i * 2 + 1] = r;
+                }
+            }break;
+            case SND_TP_OGG: {
+                int err;
+                stb_vorbis* ogg = stb_vorbis_open_memory((const unsigned char*)snd->udata, snd->udataSize, &err, NULL);
+                i16* pcm = (i16*)malloc(max(snd->length, (u32)1) * 2 * sizeof(i16));
+                if (!ogg || !pcm) {
+                    PERR("SoundBaker::decode_ - could not decode ogg.\n");
+                    if (ogg) {
+                        stb_vorbis_close(ogg);
+                    }
+                    free(pcm);
+                    free(out);
+                    return NULL;
+                }
+                u32 n = (u32)stb_vorbis_get_samples_short_interleaved(ogg, 2, pcm, snd->length * 2);
+                stb_vorbis_close(ogg);
+                for (u32 i = 0; i < snd->length * 2; i++) {
+                    out[i] = (i < n * 2) ? (float)pcm[i] : 0.f;
+                }
+                free(pcm);
+            }break;
+            default: {
+                NEVER_GET_HERE("Unknown sound type.\n");
+                free(out);
+                return NULL;
+            }
+        }
+        return out;
+    }
+
+    void SoundBaker::resample_(const float* src, u32 src_frames, u32 src_rate, i16* dst, u32 dst_frames, u32 dst_rate) {
+        const float* k = kernel_();
+        const double step = src_rate / (double)dst_rate;
+        // when downsampling kernel is stretched to cut off above target nyquist
+        const float scale = (float)min(1.0, dst_rate / (double)src_rate);
+        const i32 half = (i32)ceil(SND_BAKE_ZERO_CROSSINGS / scale);
+
+        for (u32 o = 0; o < dst_frames; o++) {
+            double t = o * step;
+            i32 c = (i32)t;
+            float frac = (float)(t - c);
+            float l = 0.f, r = 0.f;
+
+            if (frac == 0.f && scale == 1.f) {
+                // kernel is zero at every other integer offset
+                l = src[c * 2];
+                r = src[c * 2 + 1];
+            }
+            else {
+                i32 from = max(c - half + 1, 0);
+                i32 to = min(c + half, (i32)src_frames - 1);
+                for (i32 i = from; i <= to; i++) {
+                    float pos = fabsf((i - c - frac) * scale) * SND_BAKE_TABLE_RES;
+                    u32 ip = (u32)pos;
+                    if (ip >= SND_BAKE_ZERO_CROSSINGS * SND_BAKE_TABLE_RES) {
+                        continue;
+                    }
+                    float w = k[ip] + (k[ip + 1] - k[ip]) * (pos - ip);
+                    l += src[i * 2] * w;
+                    r += src[i * 2 + 1] * w;
+                }
+                l *= scale;
+                r *= scale;
+            }
+            dst[o * 2] = (i16)clampToRange((int)lrintf(l), -32768, 32767);
+            dst[o * 2 + 1] = (i16)clampToRange((int)lrintf(r), -32768, 32767);
+        }
+    }
+
+    const float* SoundBaker::kernel_() {
+        // blackman windowed sinc sampled over half-width, last entry is zero guard for interpolation
+        static struct Kernel {
+            Kernel() {
+                const u32 size = SND_BAKE_ZERO_CROSSINGS * SND_BAKE_TABLE_RES;
+                for (u32 i = 0; i < size; i++) {
+                    double x = i / (double)SND_BAKE_TABLE_RES;
+                    double u = x / SND_BAKE_ZERO_CROSSINGS;
+                    double sinc = (i == 0) ? 1. : sin(SND_BAKE_PI * x) / (SND_BAKE_PI * x);
+                    double win = 0.42 + 0.5 * cos(SND_BAKE_PI * u) + 0.08 * cos(2. * SND_BAKE_PI * u);
+                    table[i] = (float)(sinc * win);
+                }
+                table[size] = 0.f;
+            }
+            float table[SND_BAKE_ZERO_CROSSINGS * SND_BAKE_TABLE_RES + 1];
+        } kernel;
+        return kernel.table;
+    }
+}
+
+#undef SND_BAKE_PI
@@ -0,0 +1,33 @@
+#ifndef SOUND_BAKE_H
+#define SOUND_BAKE_H
+
+#include "sound_base.h"
+
+namespace grynca {
+
+#define SND_BAKE_ZERO_CROSSINGS (16)        /* windowed sinc half-width */
+#define SND_BAKE_TABLE_RES (256)            /* kernel table entries per zero crossing */
+
+    // Converts sounds to interleaved stereo s16 at given sample rate, so they take the unity-rate path in mixer.
+    // Baked sound is wav type, its udata is malloc'ed and owned by caller (free with clearBaked()).
+    class SoundBaker {
+    public:
+        static bool bake(const Sound* snd, u32 sample_rate, Sound* baked);
+        // bakes on all hardware threads, returns number of successfully baked sounds
+        static u32 bakeParallel(const Sound** snds, Sound* baked, u32 count, u32 sample_rate);
+        static void clearBaked(Sound* baked);
+
+    private:
+        static float* decode_(const Sound* snd);
+        static void resample_(const float* src, u32 src_frames, u32 src_rate, i16* dst, u32 dst_frames, u32 dst_rate);
+        static const float* kernel_();
+    };
+
+}
+
+#endif //SOUND_BAKE_H
+
+#if !defined(SOUND_BAKE_IMPL) && defined(GENG_GAME_IMPL)
+#define SOUND_BAKE_IMPL
+#include "sound_bake.cpp"
+#endif //SOUND_BAKE_IMPL
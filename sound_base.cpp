@@ -1,5 +1,6 @@
 #include "sound_base.h"
 #include "grynca_common.h"
+#include <ctype.h>
 
 namespace grynca {
 
@@ -13,6 +14,7 @@ namespace grynca {
         int idlen = (int)strlen(id);        
         char* p = data + 12;
     next:
+        if (p + 8 > data + len) return NULL;
         *size = *((u32*)(p + 4));
         if (memcmp(p, id, idlen)) {
             p += 8 + *size;
@@ -62,11 +64,24 @@ namespace grynca {
         }
 
         /* Init struct */
-        w->data_offset = len - sz;
+        w->data_offset = (int)(p - (char*)data);
         w->samplerate = samplerate;
         w->channels = channels;
         w->length = (sz / (bitdepth / 8)) / channels;
         w->bitdepth = bitdepth;
+        w->loop_start = 0;
+        w->loop_end = w->length;
+
+        /* Optional smpl subchunk, first loop is used */
+        p = find_subchunk((char*)data, len, "smpl", &sz);
+        if (p && sz >= 36 + 24 && *((u32*)(p + 28)) > 0) {
+            const u32 start = *((u32*)(p + 36 + 8));
+            const u32 end = *((u32*)(p + 36 + 12)) + 1;   /* inclusive in file */
+            if (start < end && end <= (u32)w->length) {
+                w->loop_start = start;
+                w->loop_end = end;
+            }
+        }
         /* Done */
         return true;
     }
@@ -81,6 +96,8 @@ namespace grynca {
         udataSize = IID32; 
         udata_offset = 0; 
         udata = NULL;
+        loop_start = 0;
+        loop_end = IID32;
     }
 
 
@@ -97,6 +114,16 @@ namespace grynca {
         return false;
     }
 
+    static bool read_loop_tag(const char* comment, const char* tag, u32* value) {
+        /* tags are case insensitive, e.g. LOOPSTART=44100 */
+        int taglen = (int)strlen(tag);
+        for (int i = 0; i < taglen; ++i) {
+            if (toupper((unsigned char)comment[i]) != tag[i]) return false;
+        }
+        *value = (u32)strtoul(comment + taglen, NULL, 10);
+        return true;
+    }
+
     bool SoundInfo::fillOggSoundInfo(Sound* snd) {
         if (check_header(snd->udata, snd->udataSize, "OggS", 0)) {
             int err;
@@ -113,6 +140,26 @@ namespace grynca {
             snd->channels = (u8)ogginfo.channels;
             snd->bitdepth = IID16;
 
+            u32 loop_start = 0, loop_end = snd->length, loop_length = IID32;
+            stb_vorbis_comment comments = stb_vorbis_get_comment(ogg);
+            for (int i = 0; i < comments.comment_list_length; ++i) {
+                const char* c = comments.comment_list[i];
+                read_loop_tag(c, "LOOPSTART=", &loop_start);
+                read_loop_tag(c, "LOOPEND=", &loop_end);
+                read_loop_tag(c, "LOOPLENGTH=", &loop_length);
+            }
+            if (loop_length != IID32) {
+                loop_end = loop_start + loop_length;
+            }
+            if (loop_start < loop_end && loop_end <= snd->length) {
+                snd->loop_start = loop_start;
+                snd->loop_end = loop_end;
+            }
+            else {
+                snd->loop_start = 0;
+                snd->loop_end = snd->length;
+            }
+
             stb_vorbis_close(ogg);
 
             return true;
@@ -138,6 +185,8 @@ namespace grynca {
             snd->sample_rate = wav.samplerate;
             snd->length = wav.length;
             snd->udata_offset = wav.data_offset;
+            snd->loop_start = wav.loop_start;
+            snd->loop_end = wav.loop_end;
 
             return true;
         }
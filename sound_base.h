@@ -16,6 +16,8 @@ namespace grynca {
         int samplerate;
         int channels;
         int length;
+        int loop_start;
+        int loop_end;
     } Wav;
 
     struct Stream {
@@ -23,6 +25,8 @@ namespace grynca {
 
         u8 type_id;
         void* data;           // data from asset manager, do not alloc/free them
+        u32 loop_start;       // frame where stream wraps to
+        u32 loop_end;         // frame after which stream wraps (exclusive)
         union {
             struct {
                 u8 channels;
@@ -33,6 +37,13 @@ namespace grynca {
             } wav;
             struct {
                 stb_vorbis* vorbis;
+                stb_vorbis* spare;      // swapped in on wrap when positioned right after loop cache
+                i16* loop_cache;        // decoded frames from cache_start, NULL when sound is not looped
+                u32 cache_start;        // loop start the cache was built for
+                u32 cache_frames;
+                u32 cache_idx;          // == cache_frames when cache is not being played
+                u32 pos;                // decoded frames position
+                u8 spare_ready;         // spare is positioned, set off the audio thread by SoundPlayer::update()
             } ogg;
         };
     };
@@ -49,7 +60,7 @@ namespace grynca {
 
     struct Sound {
         Sound() 
-            : sound_id(IID32), length(IID32), sample_rate(IID32), type(IID8), channels(IID8), bitdepth(IID16), udataSize(IID32), udata_offset(0), udata(NULL) {}
+            : sound_id(IID32), length(IID32), sample_rate(IID32), type(IID8), channels(IID8), bitdepth(IID16), udataSize(IID32), udata_offset(0), udata(NULL), loop_start(0), loop_end(IID32) {}
 
         void clear();
 
@@ -62,6 +73,8 @@ namespace grynca {
         u32 udataSize;
         u32 udata_offset;
         void* udata;
+        u32 loop_start;         // loop points in frames, whole sound is looped when not set in asset
+        u32 loop_end;
     };
 
     class SoundInfo {
@@ -0,0 +1,271 @@
+#include "sound_effects.h"
+#include "grynca_common.h"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define SND_FX_SSE2
+#   include <emmintrin.h>
+#endif
+
+namespace grynca {
+
+#define SND_FX_PI               (3.14159265358979323846)
+#define SND_FX_DENORMAL_LIMIT   (1e-15f)
+#define SND_FX_FLUSH(x)         ((x) = (fabsf(x) < SND_FX_DENORMAL_LIMIT) ? 0.f : (x))
+
+    /// ///////////////////////////// ///
+    //  ------- BiquadCascade -------  //
+    /// ///////////////////////////// ///
+    BiquadCascade::BiquadCascade()
+        : stages_count_(0)
+    {
+        // identity stages, so enabling a stage that was never set is harmless
+        for (u32 i = 0; i < SND_FX_MAX_BIQUADS; ++i) {
+            Stage& st = stages_[i];
+            st.b0 = 1.f;
+            st.b1 = st.b2 = st.a1 = st.a2 = 0.f;
+            st.z1[0] = st.z1[1] = 0.f;
+            st.z2[0] = st.z2[1] = 0.f;
+        }
+    }
+
+    void BiquadCascade::setStage(u32 stage, u32 type, double freq, double q, double gain_db, u32 sample_rate) {
+        ASSERT(stage < SND_FX_MAX_BIQUADS);
+        double w0 = 2. * SND_FX_PI * clampToRange(freq, 10., sample_rate * 0.49) / sample_rate;
+        double cosw = cos(w0);
+        double alpha = sin(w0) / (2. * max(q, 0.01));
+        double A = pow(10., gain_db / 40.);
+        double sq = 2. * sqrt(A) * alpha;
+        double b0, b1, b2, a0, a1, a2;
+
+        switch (type) {
+            case SND_FX_BQ_LOWPASS: {
+                b0 = (1. - cosw) / 2.; b1 = 1. - cosw; b2 = b0;
+                a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+            }break;
+            case SND_FX_BQ_HIGHPASS: {
+                b0 = (1. + cosw) / 2.; b1 = -(1. + cosw); b2 = b0;
+                a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+            }break;
+            case SND_FX_BQ_BANDPASS: {
+                b0 = alpha; b1 = 0.; b2 = -alpha;
+                a0 = 1. + alpha; a1 = -2. * cosw; a2 = 1. - alpha;
+            }break;
+            case SND_FX_BQ_PEAK: {
+                b0 = 1. + alpha * A; b1 = -2. * cosw; b2 = 1. - alpha * A;
+                a0 = 1. + alpha / A; a1 = -2. * cosw; a2 = 1. - alpha / A;
+            }break;
+            case SND_FX_BQ_LOWSHELF: {
+                b0 = A * ((A + 1.) - (A - 1.) * cosw + sq);
+                b1 = 2. * A * ((A - 1.) - (A + 1.) * cosw);
+                b2 = A * ((A + 1.) - (A - 1.) * cosw - sq);
+                a0 = (A + 1.) + (A - 1.) * cosw + sq;
+                a1 = -2. * ((A - 1.) + (A + 1.) * cosw);
+                a2 = (A + 1.) + (A - 1.) * cosw - sq;
+            }break;
+            case SND_FX_BQ_HIGHSHELF: {
+                b0 = A * ((A + 1.) + (A - 1.) * cosw + sq);
+                b1 = -2. * A * ((A - 1.) + (A + 1.) * cosw);
+                b2 = A * ((A + 1.) + (A - 1.) * cosw - sq);
+                a0 = (A + 1.) - (A - 1.) * cosw + sq;
+                a1 = 2. * ((A - 1.) - (A + 1.) * cosw);
+                a2 = (A + 1.) - (A - 1.) * cosw - sq;
+            }break;
+            default: {
+                NEVER_GET_HERE("Unknown biquad type.\n");
+                return;
+            }
+        }
+
+        Stage& st = stages_[stage];
+        st.b0 = (float)(b0 / a0);
+        st.b1 = (float)(b1 / a0);
+        st.b2 = (float)(b2 / a0);
+        st.a1 = (float)(a1 / a0);
+        st.a2 = (float)(a2 / a0);
+        if (stage >= stages_count_) {
+            setStagesCount(stage + 1);
+        }
+    }
+
+    void BiquadCascade::setStagesCount(u32 count) {
+        ASSERT(count <= SND_FX_MAX_BIQUADS);
+        // newly enabled stages start from silence
+        for (u32 i = stages_count_; i < count; ++i) {
+            stages_[i].z1[0] = stages_[i].z1[1] = 0.f;
+            stages_[i].z2[0] = stages_[i].z2[1] = 0.f;
+        }
+        stages_count_ = count;
+    }
+
+    void BiquadCascade::reset() {
+        for (u32 i = 0; i < SND_FX_MAX_BIQUADS; ++i) {
+            stages_[i].z1[0] = stages_[i].z1[1] = 0.f;
+            stages_[i].z2[0] = stages_[i].z2[1] = 0.f;
+        }
+    }
+
+    void BiquadCascade::process(float* data, u32 frames) {
+        // whole block is run through one stage before the next one, so coefficients and state stay in registers
+        for (u32 s = 0; s < stages_count_; ++s) {
+            Stage& st = stages_[s];
+#ifdef SND_FX_SSE2
+            const __m128 b0 = _mm_set1_ps(st.b0);
+            const __m128 b1 = _mm_set1_ps(st.b1);
+            const __m128 b2 = _mm_set1_ps(st.b2);
+            const __m128 a1 = _mm_set1_ps(st.a1);
+            const __m128 a2 = _mm_set1_ps(st.a2);
+            __m128 z1 = _mm_setr_ps(st.z1[0], st.z1[1], 0.f, 0.f);
+            __m128 z2 = _mm_setr_ps(st.z2[0], st.z2[1], 0.f, 0.f);
+            float* p = data;
+            for (u32 i = 0; i < frames; ++i) {
+                __m128 x = _mm_castpd_ps(_mm_load_sd((const double*)p));
+                __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+                z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+                z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+                _mm_store_sd((double*)p, _mm_castps_pd(y));
+                p += 2;
+            }
+            float tmp[4];
+            _mm_storeu_ps(tmp, z1);
+            st.z1[0] = tmp[0]; st.z1[1] = tmp[1];
+            _mm_storeu_ps(tmp, z2);
+            st.z2[0] = tmp[0]; st.z2[1] = tmp[1];
+#else
+            float z1[2] = { st.z1[0], st.z1[1] };
+            float z2[2] = { st.z2[0], st.z2[1] };
+            float* p = data;
+            for (u32 i = 0; i < frames; ++i) {
+                for (u32 c = 0; c < 2; ++c) {
+                    float x = p[c];
+                    float y = st.b0 * x + z1[c];
+                    z1[c] = st.b1 * x - st.a1 * y + z2[c];
+                    z2[c] = st.b2 * x - st.a2 * y;
+                    p[c] = y;
+                }
+                p += 2;
+            }
+            st.z1[0] = z1[0]; st.z1[1] = z1[1];
+            st.z2[0] = z2[0]; st.z2[1] = z2[1];
+#endif
+            // keep decaying state out of denormal range
+            SND_FX_FLUSH(st.z1[0]); SND_FX_FLUSH(st.z1[1]);
+            SND_FX_FLUSH(st.z2[0]); SND_FX_FLUSH(st.z2[1]);
+        }
+    }
+
+    /// ///////////////////////////// ///
+    //  --------- FdnReverb ---------  //
+    /// ///////////////////////////// ///
+    FdnReverb::FdnReverb()
+        : lines_(NULL), feedback_(0.f), damping_(0.f), wet_(0.f)
+    {
+        for (u32 k = 0; k < SND_FX_FDN_LINES; ++k) {
+            length_[k] = offset_[k] = pos_[k] = 0;
+            lp_[k] = 0.f;
+        }
+    }
+
+    FdnReverb::~FdnReverb() {
+        deinit();
+    }
+
+    bool FdnReverb::init(u32 sample_rate) {
+        // mutually prime lengths tuned for 44.1kHz
+        static const u32 base_lengths[SND_FX_FDN_LINES] = { 1109, 1277, 1423, 1559 };
+
+        deinit();
+        u32 total = 0;
+        for (u32 k = 0; k < SND_FX_FDN_LINES; ++k) {
+            length_[k] = max((u32)((u64)base_lengths[k] * sample_rate / 44100), (u32)1);
+            offset_[k] = total;
+            pos_[k] = 0;
+            total += length_[k];
+        }
+        lines_ = (float*)malloc(total * sizeof(float));
+        if (!lines_) {
+            PERR("FdnReverb::init - could not allocate delay lines.\n");
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void FdnReverb::deinit() {
+        free(lines_);
+        lines_ = NULL;
+    }
+
+    void FdnReverb::setParams(double room_size, double damping, double wet) {
+        feedback_ = (float)(0.7 + 0.28 * clampToRange(room_size, 0., 1.));
+        damping_ = (float)clampToRange(damping, 0., 1.);
+        wet_ = (float)clampToRange(wet, 0., 1.);
+    }
+
+    void FdnReverb::reset() {
+        if (lines_) {
+            u32 total = offset_[SND_FX_FDN_LINES - 1] + length_[SND_FX_FDN_LINES - 1];
+            memset(lines_, 0, total * sizeof(float));
+        }
+        for (u32 k = 0; k < SND_FX_FDN_LINES; ++k) {
+            pos_[k] = 0;
+            lp_[k] = 0.f;
+        }
+    }
+
+    void FdnReverb::process(float* data, u32 frames) {
+        // feedback matrix is hadamard scaled by 1/2 (orthogonal), so decay is given only by feedback_
+        const float fb = feedback_ * 0.5f;
+        const float damp = damping_;
+        const float wet = wet_ * 0.5f;
+        float* p = data;
+        for (u32 i = 0; i < frames; ++i) {
+            float in = (p[0] + p[1]) * 0.25f;
+            float o[SND_FX_FDN_LINES];
+            for (u32 k = 0; k < SND_FX_FDN_LINES; ++k) {
+                float x = lines_[offset_[k] + pos_[k]];
+                lp_[k] = x + damp * (lp_[k] - x);
+                o[k] = lp_[k];
+            }
+            float s01 = o[0] + o[1], d01 = o[0] - o[1];
+            float s23 = o[2] + o[3], d23 = o[2] - o[3];
+            lines_[offset_[0] + pos_[0]] = in + fb * (s01 + s23);
+            lines_[offset_[1] + pos_[1]] = in + fb * (d01 + d23);
+            lines_[offset_[2] + pos_[2]] = in + fb * (s01 - s23);
+            lines_[offset_[3] + pos_[3]] = in + fb * (d01 - d23);
+            for (u32 k = 0; k < SND_FX_FDN_LINES; ++k) {
+                if (++pos_[k] == length_[k]) {
+                    pos_[k] = 0;
+                }
+            }
+            p[0] += wet * (o[0] + o[2]);
+            p[1] += wet * (o[1] + o[3]);
+            p += 2;
+        }
+        for (u32 k = 0; k < SND_FX_FDN_LINES; ++k) {
+            SND_FX_FLUSH(lp_[k]);
+        }
+    }
+
+    /// //////////////////////////////// ///
+    //  ------- SoundEffectChain -------  //
+    /// //////////////////////////////// ///
+    void SoundEffectChain::reset() {
+        filter_.reset();
+        reverb_.reset();
+    }
+
+    void SoundEffectChain::process(float* data, u32 frames) {
+        if (filter_.isActive()) {
+            filter_.process(data, frames);
+        }
+        if (reverb_.isActive()) {
+            reverb_.process(data, frames);
+        }
+    }
+}
+
+#undef SND_FX_PI
+#undef SND_FX_DENORMAL_LIMIT
+#undef SND_FX_FLUSH
+#undef SND_FX_SSE2
@@ -0,0 +1,96 @@
+#ifndef SOUND_EFFECTS_H
+#define SOUND_EFFECTS_H
+
+#include "sound_base.h"
+
+namespace grynca {
+
+#define SND_FX_MAX_BIQUADS (4)
+#define SND_FX_FDN_LINES (4)
+
+    enum {
+        SND_FX_BQ_LOWPASS,
+        SND_FX_BQ_HIGHPASS,
+        SND_FX_BQ_BANDPASS,
+        SND_FX_BQ_PEAK,
+        SND_FX_BQ_LOWSHELF,
+        SND_FX_BQ_HIGHSHELF
+    };
+
+    // Cascade of biquads (transposed direct form II) over interleaved stereo float block,
+    // left and right channel are processed as lanes of one SIMD register
+    class BiquadCascade {
+    public:
+        BiquadCascade();
+
+        // stages up to given one are enabled, stages never set pass signal through unchanged,
+        // freq in Hz, gain_db used only by peak/shelf types
+        void setStage(u32 stage, u32 type, double freq, double q, double gain_db, u32 sample_rate);
+        void setStagesCount(u32 count);
+        void reset();
+
+        bool isActive() const { return stages_count_ != 0; }
+        void process(float* data, u32 frames);
+    private:
+        struct Stage {
+            float b0, b1, b2, a1, a2;
+            float z1[2];
+            float z2[2];
+        };
+
+        Stage stages_[SND_FX_MAX_BIQUADS];
+        u32 stages_count_;
+    };
+
+    // Feedback delay network reverb (4 lines, hadamard feedback matrix, damped)
+    class FdnReverb {
+    public:
+        FdnReverb();
+        ~FdnReverb();
+
+        // allocates (frees) delay lines, must not be called from the audio thread
+        // and chain must not be attached to player meanwhile (detach it with NULL first)
+        bool init(u32 sample_rate);
+        void deinit();
+
+        // room_size, damping and wet are in <0, 1>
+        void setParams(double room_size, double damping, double wet);
+        void reset();
+
+        bool isActive() const { return lines_ != NULL && wet_ > 0.f; }
+        void process(float* data, u32 frames);
+    private:
+        float* lines_;
+        u32 length_[SND_FX_FDN_LINES];
+        u32 offset_[SND_FX_FDN_LINES];
+        u32 pos_[SND_FX_FDN_LINES];
+        float lp_[SND_FX_FDN_LINES];
+        float feedback_;
+        float damping_;
+        float wet_;
+    };
+
+    // Effects processed over whole mixer blocks, attachable to SoundInstance or to a bus.
+    // Chain is owned by the caller and must outlive its attachment. Parameters may be changed while attached,
+    // player picks them up at next block, reverb init()/deinit() need the chain detached.
+    class SoundEffectChain {
+    public:
+        BiquadCascade& accFilter() { return filter_; }
+        FdnReverb& accReverb() { return reverb_; }
+
+        bool isActive() const { return filter_.isActive() || reverb_.isActive(); }
+        void reset();
+        void process(float* data, u32 frames);
+    private:
+        BiquadCascade filter_;
+        FdnReverb reverb_;
+    };
+
+}
+
+#endif //SOUND_EFFECTS_H
+
+#if !defined(SOUND_EFFECTS_IMPL) && defined(GENG_GAME_IMPL)
+#define SOUND_EFFECTS_IMPL
+#include "sound_effects.cpp"
+#endif //SOUND_EFFECTS_IMPL
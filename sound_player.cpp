@@ -50,7 +50,7 @@ namespace grynca {
                 i16* dst = e->buffer;
                 u32 len = e->length / 2;
             fill:
-                n = min(len, s->wav.length - s->wav.idx);
+                n = min(len, s->loop_end - s->wav.idx);
                 len -= n;
                 if (s->wav.bitdepth == 16 && s->wav.channels == 1) {
                     WAV_PROCESS_LOOP({
@@ -78,7 +78,7 @@ namespace grynca {
                 }
                 /* Loop back and continue filling buffer if we didn't fill the buffer */
                 if (len > 0) {
-                    s->wav.idx = 0;
+                    s->wav.idx = s->loop_start;
                     goto fill;
                 }
             }break;
@@ -99,6 +99,10 @@ namespace grynca {
         switch (e->type) {
             case CM_EVENT_DESTROY: {
                 stb_vorbis_close(s->ogg.vorbis);
+                if (s->ogg.spare) {
+                    stb_vorbis_close(s->ogg.spare);
+                }
+                free(s->ogg.loop_cache);
                 free(s->data);
                 free(s);
             }break;
@@ -106,11 +110,38 @@ namespace grynca {
                 len = e->length;
                 buf = e->buffer;
             fill:
-                n = stb_vorbis_get_samples_short_interleaved(s->ogg.vorbis, 2, buf, len);
+                if (s->ogg.cache_idx < s->ogg.cache_frames) {
+                    // loop start is played from cache, decoder swapped in on wrap continues right after it
+                    n = (int)min((u32)len / 2, s->ogg.cache_frames - s->ogg.cache_idx);
+                    memcpy(buf, s->ogg.loop_cache + s->ogg.cache_idx * 2, n * 2 * sizeof(i16));
+                    s->ogg.cache_idx += n;
+                    s->ogg.pos += n;
+                    buf += n * 2;
+                    len -= n * 2;
+                    if (len == 0) {
+                        break;
+                    }
+                }
+                n = stb_vorbis_get_samples_short_interleaved(s->ogg.vorbis, 2, buf, min(len, (int)(s->loop_end - s->ogg.pos) * 2));
+                s->ogg.pos += n;
                 n *= 2;
-                // rewind and fill remaining buffer if we reached the end of the ogg before filling it
+                // wrap to loop start and fill remaining buffer if we reached the loop end before filling it
                 if (len != n) {
-                    stb_vorbis_seek_start(s->ogg.vorbis);
+                    if (s->ogg.loop_cache && s->ogg.cache_start == s->loop_start && s->ogg.spare_ready) {
+                        // swapped out decoder is repositioned by SoundPlayer::update() off the audio thread
+                        stb_vorbis* v = s->ogg.vorbis;
+                        s->ogg.vorbis = s->ogg.spare;
+                        s->ogg.spare = v;
+                        s->ogg.spare_ready = 0;
+                        s->ogg.cache_idx = 0;
+                    }
+                    else if (s->loop_start) {
+                        stb_vorbis_seek(s->ogg.vorbis, s->loop_start);
+                    }
+                    else {
+                        stb_vorbis_seek_start(s->ogg.vorbis);
+                    }
+                    s->ogg.pos = s->loop_start;
                     buf += n;
                     len -= n;
                     goto fill;
@@ -118,6 +149,8 @@ namespace grynca {
             }break;
             case CM_EVENT_REWIND: {
                 stb_vorbis_seek_start(s->ogg.vorbis);
+                s->ogg.pos = 0;
+                s->ogg.cache_idx = s->ogg.cache_frames;
             }break;
         }
     }
@@ -134,37 +167,104 @@ namespace grynca {
 
 
     SoundInstance* SoundManager::getSound(const Sound* snd, const SoundConfig& config) {
+        bool reused;
+        SoundInstance* sinst = acquireSound_(snd, &reused);
+        if (!sinst) {
+            return NULL;
+        }
+        if (!prepareSound_(sinst, snd, config, reused)) {
+            discardSound_(sinst);
+            return NULL;
+        }
+        linkSound_(sinst);
+        sinst->pinned = 0;
+        sinst->state = CM_STATE_PLAYING;
+        return sinst;
+    }
+
+    SoundInstance* SoundManager::acquireSound_(const Sound* snd, bool* reused) {
         SoundInstance* sinst = tryReuseSound_(snd->sound_id);
+        *reused = (sinst != NULL);
+        if (!sinst) {
+            sinst = acquireVoice_();
+        }
         if (sinst) {
+            // pinned voice is not reused, stolen or mixed until it is linked
+            sinst->pinned = 1;
+        }
+        return sinst;
+    }
+
+    bool SoundManager::prepareSound_(SoundInstance* sinst, const Sound* snd, const SoundConfig& config, bool reused) {
+        if (reused) {
             sinst->rewind = 1;
-            sinst->loop = config.loop;
+            sinst->set_loop(snd, config.loop);
             sinst->set_gain(config.gain);
-            sinst->state = CM_STATE_PLAYING;
+            sinst->bus = 0;
+            sinst->effects = NULL;
+            sinst->reset_matrix();
+            return true;
         }
-        else {
-            sinst = addItem();
-            sinst->init(snd, config.sample_rate, config.loop);
-            switch (snd->type) {
-                case SND_TP_OGG: {
-                    if (!sinst->oggInit(snd)) {
-                        removeItem(sinst->getIndex());
-                        return NULL;
-                    }
-                }break;
-                case SND_TP_WAV: {
-                    sinst->wavInit(snd);
-                }break;
-            }
+
+        sinst->releaseStream();
+        sinst->init(snd, config.sample_rate, config.loop);
+        switch (snd->type) {
+            case SND_TP_OGG: {
+                if (!sinst->oggInit(snd)) {
+                    return false;
+                }
+            }break;
+            case SND_TP_WAV: {
+                sinst->wavInit(snd);
+            }break;
         }
+        return true;
+    }
 
+    void SoundManager::linkSound_(SoundInstance* sinst) {
+        sinst->play_stamp = play_counter_++;
         u32 inst_pos = sinst->getIndex().index;
         playing_sounds_.set(inst_pos);
-        return sinst;
+    }
+
+    void SoundManager::discardSound_(SoundInstance* sinst) {
+        releaseVoice_(sinst);
+    }
+
+    void SoundManager::releaseVoice_(SoundInstance* sinst) {
+        stopInstance_(sinst);
+        sinst->pinned = 0;
+        sinst->releaseStream();
+        sinst->sound_id = IID32;
+        if (voices_capacity_) {
+            // reserved voice is recreated free in the same slot, changed index version invalidates handles to it
+            removeItem(sinst->getIndex());
+            addItem();
+        }
+    }
+
+    void SoundManager::reserveVoices(u32 count) {
+        while (getSize() < count) {
+            addItem();
+        }
+        voices_capacity_ = max(voices_capacity_, count);
     }
 
     void SoundManager::clear() {
         playing_sounds_.clear();
 
+        if (voices_capacity_) {
+            // reserved voices stay allocated, only their streams are released
+            for (u32 i = 0; i < getSize(); ++i) {
+                SoundInstance* sinst = tryAccItemAtPos(i);
+                if (sinst != NULL) {
+                    sinst->state = CM_STATE_STOPPED;
+                    sinst->releaseStream();
+                    sinst->sound_id = IID32;
+                }
+            }
+            return;
+        }
         Manager::clear();
     }
 
@@ -173,10 +273,78 @@ namespace grynca {
         playing_sounds_.reset(inst->getIndex().index);
     }
 
+    SoundInstance* SoundManager::acquireVoice_() {
+        if (!voices_capacity_) {
+            // released voices are kept as free items, recreated when recycled so old handles to them are invalid
+            for (u32 i = 0; i < getSize(); ++i) {
+                SoundInstance* sinst = tryAccItemAtPos(i);
+                if (sinst != NULL && sinst->sound_id == IID32 && sinst->state == CM_STATE_STOPPED && !sinst->pinned) {
+                    removeItem(sinst->getIndex());
+                    return addItem();
+                }
+            }
+            return addItem();
+        }
+
+        for (u32 i = 0; i < getSize(); ++i) {
+            SoundInstance* sinst = tryAccItemAtPos(i);
+            if (sinst != NULL && sinst->state == CM_STATE_STOPPED && !sinst->pinned) {
+                return sinst;
+            }
+        }
+
+        SoundInstance* victim = findVoiceToSteal_();
+        if (victim) {
+            // item is recreated in the freed slot, so its index version changes and handle held by
+            // the previous owner is no longer valid (storage does not grow, slot is reused)
+            stopInstance_(victim);
+            victim->releaseStream();
+            removeItem(victim->getIndex());
+            victim = addItem();
+        }
+        return victim;
+    }
+
+    SoundInstance* SoundManager::findVoiceToSteal_() {
+        SoundInstance* victim = NULL;
+        u32 best = 0;
+        switch (overflow_policy_) {
+            case SND_VOICE_OVERFLOW_STEAL_OLDEST: {
+                LOOP_SET_BITS(playing_sounds_, it) {
+                    SoundInstance* sinst = accItemAtPos(it.getPos());
+                    if (sinst->pinned) {
+                        continue;
+                    }
+                    // age relative to counter is wrap-around safe
+                    u32 age = play_counter_ - sinst->play_stamp;
+                    if (!victim || age > best) {
+                        victim = sinst;
+                        best = age;
+                    }
+                }
+            }break;
+            case SND_VOICE_OVERFLOW_STEAL_QUIETEST: {
+                LOOP_SET_BITS(playing_sounds_, it) {
+                    SoundInstance* sinst = accItemAtPos(it.getPos());
+                    if (sinst->pinned) {
+                        continue;
+                    }
+                    u32 loudness = max(sinst->lgain, sinst->rgain);
+                    if (!victim || loudness < best) {
+                        victim = sinst;
+                        best = loudness;
+                    }
+                }
+            }break;
+        }
+        return victim;
+    }
+
     SoundInstance* SoundManager::tryReuseSound_(u32 sound_id) {
         LOOP_UNSET_BITS(playing_sounds_, it) {
-            SoundInstance* sinst = accItemAtPos(it.getPos());
-            if (sinst->sound_id == sound_id) {
+            // unset bits include positions without item
+            SoundInstance* sinst = tryAccItemAtPos(it.getPos());
+            if (sinst != NULL && sinst->sound_id == sound_id && !sinst->pinned) {
                 return sinst;
             }
         }
@@ -195,7 +363,10 @@ namespace grynca {
         set_pitch(1, mixer_sample_rate);
         state = CM_STATE_STOPPED;
         rewind = 1;
-        loop = looped;
+        set_loop(snd, looped);
+        bus = 0;
+        effects = NULL;
+        reset_matrix();
     }
 
     bool SoundInstance::oggInit(const Sound* snd) {
@@ -206,11 +377,80 @@ namespace grynca {
             PERR("SoundInstance::oggInit - invalid ogg data.\n");
             return false;
         }
+        stream.ogg.spare = NULL;
+        stream.ogg.loop_cache = NULL;
+        stream.ogg.cache_frames = 0;
+        stream.ogg.cache_idx = 0;
+        stream.ogg.pos = 0;
+        stream.ogg.spare_ready = 0;
         handler = ogg_handler;
         stream.type_id = snd->type;
+        direct = 0;
+        if (loop) {
+            oggInitLoopCache(snd);
+        }
+        return true;
+    }
+
+    bool SoundInstance::oggInitLoopCache(const Sound* snd) {
+        // second decoder is left positioned after cached loop start, so wrap needs no seek
+        if (stream.ogg.spare) {
+            stb_vorbis_close(stream.ogg.spare);
+            stream.ogg.spare = NULL;
+        }
+        free(stream.ogg.loop_cache);
+        stream.ogg.loop_cache = NULL;
+        stream.ogg.cache_frames = 0;
+        stream.ogg.cache_idx = 0;
+        stream.ogg.spare_ready = 0;
+
+        int err;
+        u32 frames = min((u32)SND_OGG_LOOP_CACHE_FRAMES, stream.loop_end - stream.loop_start);
+        stb_vorbis* spare = stb_vorbis_open_memory((unsigned char*)snd->udata, snd->udataSize, &err, NULL);
+        i16* cache = (i16*)malloc(frames * 2 * sizeof(i16));
+        if (!spare || !cache) {
+            PERR("SoundInstance::oggInitLoopCache - could not init loop cache, wrap will seek.\n");
+            if (spare) {
+                stb_vorbis_close(spare);
+            }
+            free(cache);
+            return false;
+        }
+        stb_vorbis_seek(spare, stream.loop_start);
+        u32 n = (u32)stb_vorbis_get_samples_short_interleaved(spare, 2, cache, frames * 2);
+        stream.ogg.spare = spare;
+        stream.ogg.loop_cache = cache;
+        stream.ogg.cache_start = stream.loop_start;
+        stream.ogg.cache_frames = n;
+        stream.ogg.cache_idx = n;
+        stream.ogg.spare_ready = 1;
         return true;
     }
 
+    void SoundInstance::set_loop(const Sound* snd, bool looped) {
+        loop = looped;
+        stream.loop_start = 0;
+        stream.loop_end = snd->length;
+        if (looped && snd->loop_start < snd->loop_end && snd->loop_end <= snd->length) {
+            stream.loop_start = snd->loop_start;
+            stream.loop_end = snd->loop_end;
+        }
+        if (stream.type_id == SND_TP_OGG && looped && (!stream.ogg.loop_cache || stream.ogg.cache_start != stream.loop_start)) {
+            oggInitLoopCache(snd);
+        }
+    }
+
+    void SoundInstance::releaseStream() {
+        if (stream.type_id == SND_TP_OGG) {
+            stb_vorbis_close(stream.ogg.vorbis);
+            if (stream.ogg.spare) {
+                stb_vorbis_close(stream.ogg.spare);
+            }
+            free(stream.ogg.loop_cache);
+        }
+        stream.type_id = IID8;
+    }
+
     void SoundInstance::wavInit(const Sound* snd) {
         stream.data = (u8*)snd->udata + snd->udata_offset;
         stream.wav.idx = 0;
@@ -218,7 +458,10 @@ namespace grynca {
         stream.wav.channels = snd->channels;
         stream.wav.samplerate = snd->sample_rate;
         stream.wav.length = snd->length;
+        stream.type_id = snd->type;
         handler = wav_handler;
+        // 16-bit stereo is mixed straight from asset memory, without going through ring buffer
+        direct = (snd->bitdepth == 16 && snd->channels == 2);
     }
 
     void SoundInstance::set_gain(double g) {
@@ -231,6 +474,26 @@ namespace grynca {
         recalc_source_gains();
     }
 
+    void SoundInstance::reset_matrix() {
+        memset(matrix, 0, sizeof(matrix));
+        matrix[0][0] = FX_UNIT;
+        matrix[1][1] = FX_UNIT;
+        spread = 0;
+    }
+
+    void SoundInstance::set_matrix(const double* gains, u32 channels) {
+        if (!gains) {
+            reset_matrix();
+            return;
+        }
+        memset(matrix, 0, sizeof(matrix));
+        for (u32 c = 0; c < channels; ++c) {
+            matrix[c][0] = (i32)FX_FROM_FLOAT(gains[c * 2]);
+            matrix[c][1] = (i32)FX_FROM_FLOAT(gains[c * 2 + 1]);
+        }
+        spread = 1;
+    }
+
     void SoundInstance::set_pitch(double pitch, u32 mixer_sample_rate) {
         double new_rate;
         if (pitch > 0.) {
@@ -247,13 +510,32 @@ namespace grynca {
     //  -------- SoundPlayer --------  //
     /// ///////////////////////////// ///
     SoundPlayer::SoundPlayer(AssetsManager* assets)
-        : device_id(IID32), assets_(assets), inst_lock_(0) {}
+        : device_id(IID32), assets_(assets), inst_lock_(0), music_cur_(NULL), music_next_(NULL), music_fade_pos_(0), music_fade_len_(0),
+          music_in_pos_(0), music_in_len_(0), music_cur_loop_(0), samplerate_(0), channels_(2),
+          mix_mode_(SND_MIX_MODE_CALLBACK), pull_buffer_(NULL), baked_(NULL), baked_count_(0), baked_rate_(0)
+    {
+        for (u32 i = 0; i < SND_BUS_COUNT; ++i) {
+            bus_effects_[i] = NULL;
+            bus_out_[i] = buffer_;
+        }
+        master_fx_ = false;
+        // equal-power curve, sin for fade in and mirrored for fade out
+        for (u32 i = 0; i <= SND_XFADE_STEPS; ++i) {
+            xfade_curve_[i] = (i32)FX_FROM_FLOAT(sin(i * 1.57079632679489661923 / SND_XFADE_STEPS));
+        }
+    }
 
     SoundPlayer::~SoundPlayer() {
         clear();
+        clearBakedSounds();
+        free(pull_buffer_);
     }
 
-    bool SoundPlayer::init() {
+    bool SoundPlayer::init(u32 channels, u32 mix_mode) {
+        if (channels != SND_CHANNELS_STEREO && channels != SND_CHANNELS_5_1 && channels != SND_CHANNELS_7_1) {
+            PERR("ERROR: [SoundPlayer::init] Unsupported channels count %u.\n", channels);
+            return false;
+        }
         i32 rslt = CALL_SDL(SDL_WasInit(SDL_INIT_AUDIO));
         if (rslt == 0) {
             rslt = CALL_SDL(SDL_InitSubSystem(SDL_INIT_AUDIO));
@@ -266,8 +548,9 @@ namespace grynca {
         spec.freq = (int)BASE_AUDIO_FREQUENCY;
         spec.samples = MIXER_BUFFER_SIZE;
         spec.format = AUDIO_S16;
-        spec.channels = 2;
-        spec.callback = audioCallback_;
+        spec.channels = (u8)channels;
+        // in pull mode device is fed by SDL_QueueAudio from render()
+        spec.callback = (mix_mode == SND_MIX_MODE_CALLBACK) ? audioCallback_ : NULL;
         spec.userdata = this;
         spec.silence = 0;
 
@@ -283,8 +566,26 @@ namespace grynca {
         // mixer init
         snd_instances_.init();
         samplerate_ = obtained.freq;
+        channels_ = obtained.channels;
+        mix_mode_ = mix_mode;
         gain_ = FX_UNIT;
 
+        free(pull_buffer_);
+        pull_buffer_ = NULL;
+        if (mix_mode_ == SND_MIX_MODE_PULL) {
+            pull_buffer_ = (i16*)malloc(SND_PULL_MAX_AHEAD_FRAMES * channels_ * sizeof(i16));
+            if (!pull_buffer_) {
+                PERR("ERROR: [SoundPlayer::init] Could not allocate pull buffer.\n");
+                return false;
+            }
+        }
+
+        if (baked_count_ && baked_rate_ != samplerate_) {
+            // device rate changed, instances may still point to old baked data
+            clearSoundInstances();
+            rebakeSounds_();
+        }
+
         // must be called as last item in init
         CALL_SDL(SDL_PauseAudioDevice(device_id, 0));
 
@@ -315,15 +616,272 @@ namespace grynca {
     }
 
     SoundInstance* SoundPlayer::play(u32 snd_id, bool looped, double gain) {
-        const Sound* snd = assets_->accSound(snd_id);
+        const Sound* snd = accPlayableSound_(snd_id);
+        const SoundConfig snd_cfg = { looped, gain, samplerate_ };
+        bool reused;
+        atomicSpinLock(&inst_lock_);
+        SoundInstance* snd_inst = snd_instances_.acquireSound_(snd, &reused);
+        atomicSpinUnlock(&inst_lock_);
+        if (!snd_inst) {
+            return NULL;
+        }
+
+        // stream is opened and rewound without inst lock, pinned voice is not touched by callback meanwhile
+        bool prepared = snd_instances_.prepareSound_(snd_inst, snd, snd_cfg, reused);
+        if (prepared) {
+            rewindSource_(snd_inst);
+        }
+
+        atomicSpinLock(&inst_lock_);
+        if (!prepared) {
+            snd_instances_.discardSound_(snd_inst);
+            snd_inst = NULL;
+        }
+        else {
+            snd_instances_.linkSound_(snd_inst);
+            snd_inst->pinned = 0;
+            snd_inst->state = CM_STATE_PLAYING;
+        }
+        atomicSpinUnlock(&inst_lock_);
+        return snd_inst;
+    }
+
+    SoundInstance* SoundPlayer::queueMusic(u32 snd_id, bool looped, double gain, u32 crossfade_frames) {
+        const Sound* snd = accPlayableSound_(snd_id);
         const SoundConfig snd_cfg = { looped, gain, samplerate_ };
+        bool reused;
         atomicSpinLock(&inst_lock_);
-        SoundInstance* snd_inst = snd_instances_.getSound(snd, snd_cfg);
-        snd_inst->state = CM_STATE_PLAYING;
+        SoundInstance* snd_inst = snd_instances_.acquireSound_(snd, &reused);
+        atomicSpinUnlock(&inst_lock_);
+        if (!snd_inst) {
+            return NULL;
+        }
+
+        // open and pre-decode first block on caller's thread without inst lock, so the switch costs
+        // nothing in callback, pinned voice is not touched by callback until it is spliced in
+        bool prepared = snd_instances_.prepareSound_(snd_inst, snd, snd_cfg, reused);
+        if (prepared) {
+            rewindSource_(snd_inst);
+            if (!snd_inst->direct) {
+                fillSourceBuffer_(snd_inst, 0, MIXER_BUFFER_SIZE / 2);
+                snd_inst->nextfill += MIXER_BUFFER_SIZE / 4;
+            }
+        }
+
+        atomicSpinLock(&inst_lock_);
+        if (!prepared) {
+            snd_instances_.discardSound_(snd_inst);
+            atomicSpinUnlock(&inst_lock_);
+            return NULL;
+        }
+        snd_instances_.linkSound_(snd_inst);
+        snd_inst->state = CM_STATE_PAUSED;
+        if (music_next_ && music_fade_len_) {
+            // crossfade is running, incoming track takes over and keeps fading in from its current gain
+            snd_instances_.stopInstance_(music_cur_);
+            music_cur_->pinned = 0;
+            music_cur_ = music_next_;
+            music_next_ = NULL;
+            music_in_pos_ = music_fade_pos_;
+            music_in_len_ = music_fade_len_;
+            music_fade_pos_ = music_fade_len_ = 0;
+        }
+        else if (music_next_) {
+            // replaces pending gapless track, current one loops again as before
+            snd_instances_.stopInstance_(music_next_);
+            music_next_->pinned = 0;
+            music_next_ = NULL;
+            music_cur_->loop = music_cur_loop_;
+        }
+        if (!music_cur_) {
+            music_cur_ = snd_inst;
+            snd_inst->state = CM_STATE_PLAYING;
+        }
+        else {
+            music_next_ = snd_inst;
+            music_fade_pos_ = 0;
+            music_fade_len_ = crossfade_frames;
+            if (!crossfade_frames) {
+                // gapless, current track finishes its play-through and next one follows
+                music_cur_loop_ = music_cur_->loop;
+                music_cur_->loop = 0;
+            }
+            else {
+                // fade starts right away, stop() on the incoming track is respected from now on
+                snd_inst->state = CM_STATE_PLAYING;
+            }
+        }
         atomicSpinUnlock(&inst_lock_);
         return snd_inst;
     }
 
+    void SoundPlayer::stopMusic() {
+        atomicSpinLock(&inst_lock_);
+        if (music_cur_) {
+            snd_instances_.stopInstance_(music_cur_);
+            music_cur_->pinned = 0;
+        }
+        if (music_next_) {
+            snd_instances_.stopInstance_(music_next_);
+            music_next_->pinned = 0;
+        }
+        music_cur_ = music_next_ = NULL;
+        music_fade_pos_ = music_fade_len_ = 0;
+        music_in_pos_ = music_in_len_ = 0;
+        atomicSpinUnlock(&inst_lock_);
+    }
+
+    u32 SoundPlayer::bakeSounds(const u32* snd_ids, u32 count) {
+        ASSERT(device_id != IID32);
+        if (!count) {
+            return 0;
+        }
+        const Sound** srcs = (const Sound**)malloc(count * sizeof(const Sound*));
+        Sound* results = (Sound*)malloc(count * sizeof(Sound));
+        if (!srcs || !results) {
+            PERR("SoundPlayer::bakeSounds - could not allocate bake buffers.\n");
+            free(srcs);
+            free(results);
+            return 0;
+        }
+        for (u32 i = 0; i < count; ++i) {
+            srcs[i] = assets_->accSound(snd_ids[i]);
+        }
+
+        SoundBaker::bakeParallel(srcs, results, count, samplerate_);
+        free(srcs);
+
+        Sound* new_baked = (Sound*)realloc(baked_, (baked_count_ + count) * sizeof(Sound));
+        if (!new_baked) {
+            PERR("SoundPlayer::bakeSounds - could not allocate baked sounds.\n");
+            for (u32 i = 0; i < count; ++i) {
+                SoundBaker::clearBaked(&results[i]);
+            }
+            free(results);
+            return 0;
+        }
+        baked_ = new_baked;
+
+        // instances built from previous data of these sounds (asset or older bake) must not be reused
+        atomicSpinLock(&inst_lock_);
+        for (u32 i = 0; i < count; ++i) {
+            if (results[i].udata) {
+                releaseInstancesOf_(snd_ids[i]);
+            }
+        }
+        atomicSpinUnlock(&inst_lock_);
+
+        u32 baked = 0;
+        for (u32 i = 0; i < count; ++i) {
+            if (!results[i].udata) {
+                PERR("SoundPlayer::bakeSounds - sound %u left unbaked.\n", snd_ids[i]);
+                continue;
+            }
+            results[i].sound_id = snd_ids[i];
+            Sound* slot = (Sound*)findBaked_(snd_ids[i]);
+            if (slot) {
+                SoundBaker::clearBaked(slot);
+            }
+            else {
+                slot = &baked_[baked_count_++];
+            }
+            *slot = results[i];
+            ++baked;
+        }
+        baked_rate_ = samplerate_;
+
+        free(results);
+        return baked;
+    }
+
+    void SoundPlayer::clearBakedSounds() {
+        atomicSpinLock(&inst_lock_);
+        for (u32 i = 0; i < baked_count_; ++i) {
+            releaseInstancesOf_(baked_[i].sound_id);
+        }
+        atomicSpinUnlock(&inst_lock_);
+        for (u32 i = 0; i < baked_count_; ++i) {
+            SoundBaker::clearBaked(&baked_[i]);
+        }
+        free(baked_);
+        baked_ = NULL;
+        baked_count_ = 0;
+    }
+
+    void SoundPlayer::rebakeSounds_() {
+        u32 count = baked_count_;
+        u32* ids = (u32*)malloc(count * sizeof(u32));
+        if (!ids) {
+            PERR("SoundPlayer::rebakeSounds_ - could not allocate ids.\n");
+            return;
+        }
+        for (u32 i = 0; i < count; ++i) {
+            ids[i] = baked_[i].sound_id;
+        }
+        clearBakedSounds();
+        bakeSounds(ids, count);
+        free(ids);
+    }
+
+    void SoundPlayer::releaseInstancesOf_(u32 snd_id) {
+        if (music_next_ && music_next_->sound_id == snd_id) {
+            if (music_fade_len_) {
+                // current track fades back in from where its fade-out got
+                music_in_pos_ = music_fade_len_ - music_fade_pos_;
+                music_in_len_ = music_fade_len_;
+            }
+            else {
+                music_cur_->loop = music_cur_loop_;
+            }
+            music_next_ = NULL;
+            music_fade_pos_ = music_fade_len_ = 0;
+        }
+        if (music_cur_ && music_cur_->sound_id == snd_id) {
+            // queued track takes over right away, crossfading one keeps fading in
+            music_cur_ = music_next_;
+            music_next_ = NULL;
+            music_in_pos_ = music_fade_pos_;
+            music_in_len_ = music_fade_len_;
+            music_fade_pos_ = music_fade_len_ = 0;
+            if (music_cur_) {
+                music_cur_->state = CM_STATE_PLAYING;
+            }
+        }
+        for (u32 i = 0; i < snd_instances_.getSize(); ++i) {
+            SoundInstance* snd_inst = snd_instances_.tryAccItemAtPos(i);
+            if (snd_inst != NULL && snd_inst->sound_id == snd_id) {
+                snd_instances_.releaseVoice_(snd_inst);
+            }
+        }
+    }
+
+    const Sound* SoundPlayer::findBaked_(u32 snd_id) const {
+        for (u32 i = 0; i < baked_count_; ++i) {
+            if (baked_[i].sound_id == snd_id) {
+                return &baked_[i];
+            }
+        }
+        return NULL;
+    }
+
+    const Sound* SoundPlayer::accPlayableSound_(u32 snd_id) {
+        const Sound* snd = findBaked_(snd_id);
+        return snd ? snd : assets_->accSound(snd_id);
+    }
+
+    void SoundPlayer::reserveVoices(u32 count) {
+        // lock keeps callback away from instances while storage grows
+        atomicSpinLock(&inst_lock_);
+        snd_instances_.reserveVoices(count);
+        atomicSpinUnlock(&inst_lock_);
+    }
+
+    void SoundPlayer::setVoiceOverflowPolicy(u32 policy) {
+        atomicSpinLock(&inst_lock_);
+        snd_instances_.setOverflowPolicy(policy);
+        atomicSpinUnlock(&inst_lock_);
+    }
+
     void SoundPlayer::stop(Index &index) {
         if(snd_instances_.isValidIndex(index)) {
             atomicSpinLock(&inst_lock_);
@@ -342,10 +900,14 @@ namespace grynca {
         }
 
         atomicSpinLock(&inst_lock_);
+        music_cur_ = music_next_ = NULL;
+        music_fade_pos_ = music_fade_len_ = 0;
+        music_in_pos_ = music_in_len_ = 0;
         for (u32 i = 0; i < snd_instances_.getSize(); ++i) {
             SoundInstance* snd_inst = snd_instances_.tryAccItemAtPos(i);
-            if (snd_inst != NULL && snd_inst->stream.type_id == SND_TP_OGG) {
-                stb_vorbis_close(snd_inst->stream.ogg.vorbis);
+            if (snd_inst != NULL) {
+                snd_inst->pinned = 0;
+                snd_inst->releaseStream();
             }
         }
         snd_instances_.clear();
@@ -356,6 +918,42 @@ namespace grynca {
         gain_ = (i32)FX_FROM_FLOAT(gain);
     }
 
+    void SoundPlayer::setEffects(Index& index, SoundEffectChain* effects) {
+        if (snd_instances_.isValidIndex(index)) {
+            atomicSpinLock(&inst_lock_);
+            // state left from previous attachment would be heard as stale tail
+            if (effects) {
+                effects->reset();
+            }
+            snd_instances_.accItem(index)->effects = effects;
+            atomicSpinUnlock(&inst_lock_);
+        }
+    }
+
+    void SoundPlayer::setBus(Index& index, u32 bus) {
+        ASSERT(bus < SND_BUS_COUNT);
+        if (snd_instances_.isValidIndex(index)) {
+            atomicSpinLock(&inst_lock_);
+            snd_instances_.accItem(index)->bus = (u8)bus;
+            atomicSpinUnlock(&inst_lock_);
+        }
+    }
+
+    void SoundPlayer::setPanMatrix(Index& index, const double* gains) {
+        if (snd_instances_.isValidIndex(index)) {
+            atomicSpinLock(&inst_lock_);
+            snd_instances_.accItem(index)->set_matrix(gains, channels_);
+            atomicSpinUnlock(&inst_lock_);
+        }
+    }
+
+    void SoundPlayer::setBusEffects(u32 bus, SoundEffectChain* effects) {
+        ASSERT(bus < SND_BUS_COUNT);
+        atomicSpinLock(&inst_lock_);
+        bus_effects_[bus] = effects;
+        atomicSpinUnlock(&inst_lock_);
+    }
+
 
     void SoundPlayer::rewindSource_(SoundInstance * src) {
         cm_Event e;
@@ -364,20 +962,22 @@ namespace grynca {
         src->handler(&e);
         src->position = 0;
         src->rewind = 0;
-        src->end = src->length;
+        src->end = src->stream.loop_end;
         src->nextfill = 0;
     }
 
 
-    void SoundPlayer::addSoundSourceToBuffer_(SoundInstance* src, u32 len) {
-        i32* dst = buffer_;
-
+    u32 SoundPlayer::addSoundSourceToBuffer_(SoundInstance* src, i32* dst, u32 len) {
         if (src->state != CM_STATE_PLAYING) {
-            return;
+            return 0;
         }
+        u32 total = len;
         if (src->rewind) {
             rewindSource_(src);
         }
+        if (src->direct) {
+            return addDirectSourceToBuffer_(src, dst, len);
+        }
 
         while (len > 0) {
             u32 frame = (u32)(src->position >> FX_BITS);
@@ -388,10 +988,10 @@ namespace grynca {
             }
 
             if (frame >= src->end) {
-                src->end = frame + src->length;
+                src->end = frame + (src->stream.loop_end - src->stream.loop_start);
                 if (!src->loop) {
                     snd_instances_.stopInstance_(src);
-                    break;
+                    return total - len;
                 }
             }
 
@@ -429,32 +1029,351 @@ namespace grynca {
                 }
             }
         }
+        return total;
     }
 
 
+    u32 SoundPlayer::addDirectSourceToBuffer_(SoundInstance* src, i32* dst, u32 len) {
+        // position is frame in asset data, spans are split at loop end
+        const i16* data = (const i16*)src->stream.data;
+        const u32 loop_start = src->stream.loop_start;
+        const u32 loop_end = src->stream.loop_end;
+        const i32 lgain = (i32)src->lgain;
+        const i32 rgain = (i32)src->rgain;
+        u32 total = len;
+
+        while (len > 0) {
+            u32 frame = (u32)(src->position >> FX_BITS);
+            if (frame >= loop_end) {
+                if (!src->loop) {
+                    snd_instances_.stopInstance_(src);
+                    return total - len;
+                }
+                src->position -= (u64)(loop_end - loop_start) << FX_BITS;
+                continue;
+            }
+
+            u32 count;
+            if (src->rate == FX_UNIT) {
+                count = min(loop_end - frame, len / 2);
+                const i16* p = data + frame * 2;
+                for (u32 i = 0; i < count; i++) {
+                    dst[0] += (p[0] * lgain) >> FX_BITS;
+                    dst[1] += (p[1] * rgain) >> FX_BITS;
+                    p += 2;
+                    dst += 2;
+                }
+                src->position += (u64)count * FX_UNIT;
+            }
+            else {
+                const u64 limit = (u64)(loop_end - 1) << FX_BITS;
+                if (src->position < limit) {
+                    // both interpolated frames are inside span
+                    count = (u32)((limit - src->position + src->rate - 1) / src->rate);
+                    count = min(count, len / 2);
+                    for (u32 i = 0; i < count; i++) {
+                        const i16* p = data + (u32)(src->position >> FX_BITS) * 2;
+                        i32 fp = (i32)(src->position & FX_MASK);
+                        dst[0] += (FX_LERP(p[0], p[2], fp) * lgain) >> FX_BITS;
+                        dst[1] += (FX_LERP(p[1], p[3], fp) * rgain) >> FX_BITS;
+                        src->position += src->rate;
+                        dst += 2;
+                    }
+                }
+                else {
+                    // last frame before loop end interpolates towards loop start
+                    count = 1;
+                    const i16* p = data + frame * 2;
+                    const i16* q = data + (src->loop ? loop_start : frame) * 2;
+                    i32 fp = (i32)(src->position & FX_MASK);
+                    dst[0] += (FX_LERP(p[0], q[0], fp) * lgain) >> FX_BITS;
+                    dst[1] += (FX_LERP(p[1], q[1], fp) * rgain) >> FX_BITS;
+                    src->position += src->rate;
+                    dst += 2;
+                }
+            }
+            len -= count * 2;
+        }
+        return total;
+    }
+
     void SoundPlayer::audioCallback_(void* ctx, Uint8* stream, int len) {
     // static
         SoundPlayer* sndPlayer = (SoundPlayer*)ctx;
-        sndPlayer->fillNextSoundSamplesRec_((i16*)stream, len / 2);
+        // internal length is in stereo samples
+        sndPlayer->fillNextSoundSamplesRec_((i16*)stream, (len / 2) / sndPlayer->channels_ * 2);
+    }
+
+    void SoundPlayer::mix(i16* dst, u32 frames) {
+        fillNextSoundSamplesRec_(dst, frames * 2);
+    }
+
+    void SoundPlayer::update() {
+        for (u32 i = 0; i < snd_instances_.getSize(); ++i) {
+            // callback does not touch spare decoder until it is marked ready, so it is seeked without lock
+            atomicSpinLock(&inst_lock_);
+            SoundInstance* snd_inst = snd_instances_.tryAccItemAtPos(i);
+            bool stale = snd_inst != NULL && snd_inst->stream.type_id == SND_TP_OGG
+                         && snd_inst->stream.ogg.spare && !snd_inst->stream.ogg.spare_ready;
+            atomicSpinUnlock(&inst_lock_);
+            if (!stale) {
+                continue;
+            }
+            Stream& s = snd_inst->stream;
+            stb_vorbis_seek(s.ogg.spare, s.ogg.cache_start + s.ogg.cache_frames);
+            atomicSpinLock(&inst_lock_);
+            s.ogg.spare_ready = 1;
+            atomicSpinUnlock(&inst_lock_);
+        }
+    }
+
+    u32 SoundPlayer::render(u32 ahead_frames) {
+        ASSERT(mix_mode_ == SND_MIX_MODE_PULL);
+        const u32 block = MIXER_BUFFER_SIZE / 2;
+        u32 queued = getQueuedFrames();
+        if (queued >= ahead_frames) {
+            return 0;
+        }
+        // whole mixer blocks, batched into single queue call
+        u32 frames = ((ahead_frames - queued + block - 1) / block) * block;
+        frames = min(frames, (u32)SND_PULL_MAX_AHEAD_FRAMES);
+        mix(pull_buffer_, frames);
+        if (CALL_SDL(SDL_QueueAudio(device_id, pull_buffer_, frames * channels_ * sizeof(i16))) != 0) {
+            const char* error = CALL_SDL(SDL_GetError());
+            PERR("SoundPlayer::render(): Could not queue audio: %s\n", error);
+            return 0;
+        }
+        return frames;
+    }
+
+    u32 SoundPlayer::getQueuedFrames() const {
+        ASSERT(device_id != IID32);
+        return CALL_SDL(SDL_GetQueuedAudioSize(device_id)) / (channels_ * sizeof(i16));
+    }
+
+    void SoundPlayer::latchBuses_() {
+        // chains are changed by caller without inst lock, so routing is decided once per block
+        // and zeroing, mixing and applying all see the same buffers
+        // buses without active effects mix straight to master
+        bus_out_[0] = buffer_;
+        master_fx_ = bus_effects_[0] && bus_effects_[0]->isActive();
+        for (u32 b = 1; b < SND_BUS_COUNT; ++b) {
+            bool active = bus_effects_[b] && bus_effects_[b]->isActive();
+            bus_out_[b] = active ? bus_buffers_[b - 1] : buffer_;
+        }
+    }
+
+    i32* SoundPlayer::accBusBuffer_(u32 bus) {
+        return bus_out_[bus];
+    }
+
+    u32 SoundPlayer::mixInstance_(SoundInstance* s, i32* out, u32 len) {
+        if (s->effects && s->effects->isActive()) {
+            memset(fx_buffer_, 0, len * sizeof(fx_buffer_[0]));
+            u32 mixed = addSoundSourceToBuffer_(s, fx_buffer_, len);
+            applyEffects_(s->effects, fx_buffer_, out, len);
+            return mixed;
+        }
+        return addSoundSourceToBuffer_(s, out, len);
+    }
+
+    void SoundPlayer::mixMusic_(u32 len) {
+        SoundInstance* cur = music_cur_;
+        SoundInstance* next = music_next_;
+        if (!cur) {
+            return;
+        }
+
+        bool fading = (next && music_fade_len_);
+        u32 mixed;
+        if (fading || music_in_len_) {
+            // crossfade (or current track still fading in), tracks go through own buffers and are weighted per frame
+            memset(xfade_buffers_[0], 0, len * sizeof(xfade_buffers_[0][0]));
+            mixed = mixInstance_(cur, xfade_buffers_[0], len);
+            i32* out_next = NULL;
+            if (fading) {
+                memset(xfade_buffers_[1], 0, len * sizeof(xfade_buffers_[1][0]));
+                mixInstance_(next, xfade_buffers_[1], len);
+                out_next = accBusBuffer_(next->bus);
+            }
+
+            i32* out_cur = accBusBuffer_(cur->bus);
+            u32 frames = len / 2;
+            for (u32 i = 0; i < frames; i++) {
+                i32 gcur = FX_UNIT;
+                if (music_in_pos_ < music_in_len_) {
+                    gcur = xfadeGain_(music_in_pos_++, music_in_len_);
+                }
+                if (fading) {
+                    i32 gin = xfadeGain_(music_fade_pos_, music_fade_len_);
+                    gcur = (gcur * xfadeGain_(music_fade_len_ - music_fade_pos_, music_fade_len_)) >> FX_BITS;
+                    if (music_fade_pos_ < music_fade_len_) {
+                        music_fade_pos_++;
+                    }
+                    out_next[i * 2] += (xfade_buffers_[1][i * 2] * gin) >> FX_BITS;
+                    out_next[i * 2 + 1] += (xfade_buffers_[1][i * 2 + 1] * gin) >> FX_BITS;
+                }
+                out_cur[i * 2] += (xfade_buffers_[0][i * 2] * gcur) >> FX_BITS;
+                out_cur[i * 2 + 1] += (xfade_buffers_[0][i * 2 + 1] * gcur) >> FX_BITS;
+            }
+            if (music_in_pos_ >= music_in_len_) {
+                music_in_pos_ = music_in_len_ = 0;
+            }
+
+            if (fading) {
+                if (music_fade_pos_ >= music_fade_len_) {
+                    snd_instances_.stopInstance_(cur);
+                    cur->pinned = 0;
+                    music_cur_ = next;
+                    music_next_ = NULL;
+                    music_fade_len_ = music_fade_pos_ = 0;
+                }
+                return;
+            }
+        }
+        else {
+            mixed = mixInstance_(cur, accBusBuffer_(cur->bus), len);
+        }
+
+        if (cur->state == CM_STATE_STOPPED) {
+            // current track ended inside this block, splice next one right behind its last frame
+            cur->pinned = 0;
+            music_cur_ = next;
+            music_next_ = NULL;
+            music_in_pos_ = music_in_len_ = 0;
+            if (next) {
+                next->state = CM_STATE_PLAYING;
+                mixInstance_(next, accBusBuffer_(next->bus) + mixed, len - mixed);
+            }
+        }
+    }
+
+    i32 SoundPlayer::xfadeGain_(u32 pos, u32 len) const {
+        // fade in gain after pos of len frames, fade out is mirrored (len - pos),
+        // interpolated between curve entries so long fades do not step
+        if (pos >= len) {
+            return xfade_curve_[SND_XFADE_STEPS];
+        }
+        u64 p = (((u64)pos * SND_XFADE_STEPS) << FX_BITS) / len;
+        u32 step = (u32)(p >> FX_BITS);
+        i32 frac = (i32)(p & FX_MASK);
+        return FX_LERP(xfade_curve_[step], xfade_curve_[step + 1], frac);
+    }
+
+    void SoundPlayer::applyEffects_(SoundEffectChain* effects, i32* src, i32* dst, u32 len) {
+        for (u32 i = 0; i < len; i++) {
+            fx_block_[i] = (float)src[i];
+        }
+        effects->process(fx_block_, len / 2);
+        if (src == dst) {
+            for (u32 i = 0; i < len; i++) {
+                dst[i] = (i32)fx_block_[i];
+            }
+        }
+        else {
+            for (u32 i = 0; i < len; i++) {
+                dst[i] += (i32)fx_block_[i];
+            }
+        }
+    }
+
+    void SoundPlayer::spreadInstance_(SoundInstance* s, u32 len) {
+        memset(voice_buffer_, 0, len * sizeof(voice_buffer_[0]));
+        mixInstance_(s, voice_buffer_, len);
+
+        u32 frames = len / 2;
+        for (u32 c = 0; c < channels_; ++c) {
+            const i32 ml = s->matrix[c][0];
+            const i32 mr = s->matrix[c][1];
+            if (ml == 0 && mr == 0) {
+                continue;
+            }
+            i32* out = planar_[c];
+            for (u32 i = 0; i < frames; i++) {
+                out[i] += (voice_buffer_[i * 2] * ml + voice_buffer_[i * 2 + 1] * mr) >> FX_BITS;
+            }
+        }
+    }
+
+    void SoundPlayer::interleaveOutput_(i16* dst, u32 frames) {
+        const u32 nch = channels_;
+        for (u32 c = 0; c < nch; ++c) {
+            const i32* src = planar_[c];
+            i16* out = dst + c;
+            if (c < 2) {
+                // front pair also carries everything mixed on stereo path
+                for (u32 i = 0; i < frames; i++) {
+                    int x = ((src[i] + buffer_[i * 2 + c]) * gain_) >> FX_BITS;
+                    out[i * nch] = (i16)(clampToRange(x, -32768, 32767));
+                }
+            }
+            else {
+                for (u32 i = 0; i < frames; i++) {
+                    int x = (src[i] * gain_) >> FX_BITS;
+                    out[i * nch] = (i16)(clampToRange(x, -32768, 32767));
+                }
+            }
+        }
     }
 
     void SoundPlayer::fillNextSoundSamplesRec_(i16 * dst, u32 len) {
+        // len is in stereo samples, dst has channels_ samples per frame
         while (len > MIXER_BUFFER_SIZE) {
             fillNextSoundSamplesRec_(dst, MIXER_BUFFER_SIZE);
-            dst += MIXER_BUFFER_SIZE;
+            dst += (MIXER_BUFFER_SIZE / 2) * channels_;
             len -= MIXER_BUFFER_SIZE;
         }
 
         memset(buffer_, 0, len * sizeof(buffer_[0]));
+        if (channels_ > 2) {
+            for (u32 c = 0; c < channels_; ++c) {
+                memset(planar_[c], 0, (len / 2) * sizeof(planar_[c][0]));
+            }
+        }
 
         // loop over all active sources
         atomicSpinLock(&inst_lock_);
+        latchBuses_();
+        for (u32 b = 1; b < SND_BUS_COUNT; ++b) {
+            i32* bus_buffer = accBusBuffer_(b);
+            if (bus_buffer != buffer_) {
+                memset(bus_buffer, 0, len * sizeof(buffer_[0]));
+            }
+        }
+
         LOOP_SET_BITS(snd_instances_.playing_sounds_, it) {
             SoundInstance* s = snd_instances_.accItemAtPos(it.getPos());
-            addSoundSourceToBuffer_(s, len);
+            if (s->pinned) {
+                // music queue voices are mixed in mixMusic_
+                continue;
+            }
+            i32* out = accBusBuffer_(s->bus);
+            // master chain runs over front pair only, so voices are not spread while it is active
+            if (channels_ > 2 && s->spread && out == buffer_ && !master_fx_) {
+                spreadInstance_(s, len);
+            }
+            else {
+                mixInstance_(s, out, len);
+            }
+        }
+        mixMusic_(len);
+
+        for (u32 b = 1; b < SND_BUS_COUNT; ++b) {
+            i32* bus_buffer = accBusBuffer_(b);
+            if (bus_buffer != buffer_) {
+                applyEffects_(bus_effects_[b], bus_buffer, buffer_, len);
+            }
+        }
+        if (master_fx_) {
+            applyEffects_(bus_effects_[0], buffer_, buffer_, len);
         }
         atomicSpinUnlock(&inst_lock_);
 
+        if (channels_ > 2) {
+            interleaveOutput_(dst, len / 2);
+            return;
+        }
+
         // copy internal buffer to destination and clamp
         for (u32 i = 0; i < len; i++) {
             int x = (buffer_[i] * gain_) >> FX_BITS;
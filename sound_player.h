@@ -2,12 +2,33 @@
 #define SOUND_PLAYER_H
 
 #include "sound_base.h"
+#include "sound_effects.h"
+#include "sound_bake.h"
 #include "../graphics2D/assets.h"
 
 namespace grynca {
 
 #define MIXER_BUFFER_SIZE (512)
 #define BASE_AUDIO_FREQUENCY 44100
+#define SND_BUS_COUNT (4)                   /* bus 0 is master, others are groups mixed into master */
+#define SND_XFADE_STEPS (256)
+#define SND_MAX_CHANNELS (8)
+#define SND_OGG_LOOP_CACHE_FRAMES (4096)    /* decoded frames kept from ogg loop start */
+#define SND_PULL_MAX_AHEAD_FRAMES (8192)    /* most frames render() queues at once, multiple of mixer block */
+
+    enum {
+        SND_MIX_MODE_CALLBACK,              /* SDL's audio thread mixes in callback */
+        SND_MIX_MODE_PULL                   /* engine mixes with mix()/render() on thread of its choice */
+    };
+
+    // output layouts, channel order follows SDL:
+    // 5.1 - FL, FR, FC, LFE, BL, BR
+    // 7.1 - FL, FR, FC, LFE, BL, BR, SL, SR
+    enum {
+        SND_CHANNELS_STEREO = 2,
+        SND_CHANNELS_5_1 = 6,
+        SND_CHANNELS_7_1 = 8
+    };
     
     enum {
         CM_STATE_STOPPED,
@@ -23,6 +44,13 @@ namespace grynca {
         CM_EVENT_REWIND
     };
 
+    // what SoundManager::getSound does when all reserved voices are playing
+    enum {
+        SND_VOICE_OVERFLOW_REJECT,
+        SND_VOICE_OVERFLOW_STEAL_OLDEST,
+        SND_VOICE_OVERFLOW_STEAL_QUIETEST
+    };
+
     struct SoundConfig {
         bool loop;
         double gain;
@@ -36,9 +64,18 @@ namespace grynca {
 
     class SoundManager : public Manager<SoundInstance> {
     public:
+        SoundManager() : voices_capacity_(0), overflow_policy_(SND_VOICE_OVERFLOW_REJECT), play_counter_(0) {}
+
         void init();
+        // Opens stream (and ogg loop cache) in place, SoundPlayer::play() does the same without holding inst lock.
         SoundInstance* getSound(const Sound* snd, const SoundConfig& config);
 
+        // Preallocates voices, after that getSound() never grows storage and overflow policy is used instead.
+        // Not real-time safe, call when audio callback is not mixing (under inst lock or before device start).
+        void reserveVoices(u32 count);
+        u32 getVoicesCapacity() const { return voices_capacity_; }
+        void setOverflowPolicy(u32 policy) { overflow_policy_ = policy; }
+
         Bits& accPlayingSounds() { return playing_sounds_; }
 
         void clear();
@@ -47,21 +84,37 @@ namespace grynca {
         friend class SoundPlayer;
         void stopInstance_(SoundInstance* inst);
 
+        // Starting sound is split so stream opening and decoding does not run under inst lock:
+        // acquireSound_() picks and pins a voice (locked), prepareSound_() opens the stream (unlocked),
+        // linkSound_() adds it to playing sounds (locked), discardSound_() returns voice on failure (locked).
+        SoundInstance* acquireSound_(const Sound* snd, bool* reused);
+        bool prepareSound_(SoundInstance* sinst, const Sound* snd, const SoundConfig& config, bool reused);
+        void linkSound_(SoundInstance* sinst);
+        void discardSound_(SoundInstance* sinst);
+        // stops voice and frees its stream, voice stays allocated as free (with voice pool recreated, so handles are invalidated)
+        void releaseVoice_(SoundInstance* sinst);
+
     private:
         SoundInstance* tryReuseSound_(u32 sound_id);
+        SoundInstance* acquireVoice_();
+        SoundInstance* findVoiceToSteal_();
 
         Bits playing_sounds_;
+        u32 voices_capacity_;               /* 0 when voices are not reserved and storage grows on demand */
+        u32 overflow_policy_;
+        u32 play_counter_;
     };
 
     class SoundInstance : public Item<SoundManager> {
     public:
-        SoundInstance(Manager* mgr, Index id) : Base(mgr, id), state(CM_STATE_STOPPED) {}
+        SoundInstance(Manager* mgr, Index id) : Base(mgr, id), handler(NULL), state(CM_STATE_STOPPED), sound_id(IID32), pinned(0) {}
         ~SoundInstance() {}
 
         void init(const Sound* snd, u32 mixer_sample_rate, bool looped);
         bool oggInit(const Sound* snd);
         void wavInit(const Sound* snd);
-
+        bool oggInitLoopCache(const Sound* snd);
+        void releaseStream();
 
     private:
         friend class SoundPlayer;
@@ -71,8 +124,11 @@ namespace grynca {
         void set_gain(double gain);
         void set_pan(double pan);
         void set_pitch(double pitch, u32 mixer_sample_rate);
+        void set_loop(const Sound* snd, bool looped);
+        void reset_matrix();
+        void set_matrix(const double* gains, u32 channels);
 
-        i16 buffer[MIXER_BUFFER_SIZE];
+        i16 buffer[MIXER_BUFFER_SIZE];      /* ring for decoded formats, unused by direct sources */
         cm_EventHandler handler;
         u32 sample_rate;                    /* Stream's native sample_rate */
         u32 length;                         /* Stream's length in frames */
@@ -83,8 +139,15 @@ namespace grynca {
         u32 rate;
         u32 nextfill;
         u32 sound_id;
+        u32 play_stamp;                     /* SoundManager's play counter when voice was started */
         u8 loop;
         u8 rewind;
+        u8 direct;                          /* mixed from stream data, see SoundPlayer::addDirectSourceToBuffer_ */
+        u8 bus;
+        u8 pinned;                          /* owned by music queue or being prepared, not reused or stolen */
+        u8 spread;                          /* uses matrix, otherwise panned stereo goes to front pair */
+        i32 matrix[SND_MAX_CHANNELS][2];    /* output channel <- (left, right) gains */
+        SoundEffectChain* effects;          /* NULL when instance has no effects */
         Stream stream;
         double gain;
         double pan;
@@ -102,7 +165,8 @@ namespace grynca {
         SoundPlayer(AssetsManager* assets);
         ~SoundPlayer();
 
-        bool init();
+        // channels must be one of SND_CHANNELS_*
+        bool init(u32 channels = SND_CHANNELS_STEREO, u32 mix_mode = SND_MIX_MODE_CALLBACK);
         void startDevice();
         void pauseDevice();
         void deinit();
@@ -111,10 +175,53 @@ namespace grynca {
         SoundInstance* play(u32 snd_id, bool looped = false, double gain = 1.0);
         void stop(Index& index);
 
+        void reserveVoices(u32 count);
+        void setVoiceOverflowPolicy(u32 policy);
+
+        // Converts sounds to stereo s16 at device rate once, they are then played from baked data on unity-rate path.
+        // Must be called after init(), playing instances of those sounds are stopped and their handles invalidated
+        // (same for clearBakedSounds()). Baked sounds are rebuilt when init() opens device with different rate.
+        // Returns number of baked sounds.
+        u32 bakeSounds(const u32* snd_ids, u32 count);
+        void clearBakedSounds();
+
+        // Music track is opened and pre-decoded on caller's thread. If music is already playing, queued track
+        // follows gapless at the end of current play-through (crossfade_frames == 0) or crossfades in right away.
+        SoundInstance* queueMusic(u32 snd_id, bool looped = true, double gain = 1.0, u32 crossfade_frames = 0);
+        void stopMusic();
+
         void clearSoundInstances();
 
         void setMasterGain(double gain);
 
+        // Effects are processed per block, chain is owned by caller (NULL detaches) and is reset when attached.
+        // Instance chain is processed only while the instance plays, so its filter/reverb tail is cut when
+        // the sound stops. Route the instance to a bus with setBus() and put the chain there to keep tails.
+        void setEffects(Index& index, SoundEffectChain* effects);
+        void setBus(Index& index, u32 bus);
+        // Bus chains process stereo front pair, in multichannel mode active master chain (bus 0)
+        // makes instances with pan matrix mix to front pair as well, so chain is applied to them.
+        void setBusEffects(u32 bus, SoundEffectChain* effects);
+
+        // gains are [output channel][left, right] for channels count given to init, NULL resets to front pair.
+        // Used only by instances on master bus in multichannel mode, group buses are mixed to front pair.
+        // While master bus has active effects, matrix is ignored and instance is mixed to front pair too.
+        void setPanMatrix(Index& index, const double* gains);
+
+        u32 getSampleRate() const { return samplerate_; }
+        u32 getChannels() const { return channels_; }
+
+        // Pull model. mix() renders interleaved frames to dst, only one thread may mix at a time
+        // (in callback mode only while device is paused). render() tops up device queue to ahead_frames
+        // in whole mixer blocks with single SDL_QueueAudio call and returns number of queued frames.
+        void mix(i16* dst, u32 frames);
+        u32 render(u32 ahead_frames);
+        u32 getQueuedFrames() const;
+
+        // Repositions decoders of looping ogg sounds swapped out at loop wrap, so next wrap needs no seek
+        // in mixer. Call once per frame from the thread that calls play(). Without it wraps fall back to seeking.
+        void update();
+
         const SoundManager* getSoundManager() const { return &snd_instances_; }
         SoundManager& accSoundManager() { return snd_instances_; }
     private:
@@ -122,7 +229,21 @@ namespace grynca {
         static void fillSourceBuffer_(SoundInstance* src, u32 offset, u32 length);
 
         void fillNextSoundSamplesRec_(i16* dst, u32 len);
-        void addSoundSourceToBuffer_(SoundInstance* src, u32 len);
+        u32 addSoundSourceToBuffer_(SoundInstance* src, i32* dst, u32 len);
+        u32 addDirectSourceToBuffer_(SoundInstance* src, i32* dst, u32 len);
+        u32 mixInstance_(SoundInstance* s, i32* out, u32 len);
+        void mixMusic_(u32 len);
+        i32 xfadeGain_(u32 pos, u32 len) const;
+        void spreadInstance_(SoundInstance* s, u32 len);
+        void interleaveOutput_(i16* dst, u32 frames);
+        void rebakeSounds_();
+        // stops and frees streams of all instances of sound, so none keeps pointing to its old data (under inst lock)
+        void releaseInstancesOf_(u32 snd_id);
+        const Sound* findBaked_(u32 snd_id) const;
+        const Sound* accPlayableSound_(u32 snd_id);
+        void applyEffects_(SoundEffectChain* effects, i32* src, i32* dst, u32 len);
+        void latchBuses_();
+        i32* accBusBuffer_(u32 bus);
         void rewindSource_(SoundInstance* src);
 
         SDL_AudioDeviceID device_id;
@@ -133,8 +254,33 @@ namespace grynca {
         volatile u32 inst_lock_;
         // mixer
         i32 buffer_[MIXER_BUFFER_SIZE];
+        i32 bus_buffers_[SND_BUS_COUNT - 1][MIXER_BUFFER_SIZE];
+        i32 fx_buffer_[MIXER_BUFFER_SIZE];
+        float fx_block_[MIXER_BUFFER_SIZE];
+        SoundEffectChain* bus_effects_[SND_BUS_COUNT];
+        i32* bus_out_[SND_BUS_COUNT];       /* where each bus mixes in current block, latched by latchBuses_() */
+        bool master_fx_;                    /* master chain is active in current block */
+        // music queue
+        SoundInstance* music_cur_;
+        SoundInstance* music_next_;
+        u32 music_fade_pos_;
+        u32 music_fade_len_;
+        u32 music_in_pos_;                  /* remaining fade in of current track, when it took over mid-crossfade */
+        u32 music_in_len_;
+        u8 music_cur_loop_;                 /* loop flag of current track before gapless queue cleared it */
+        i32 xfade_curve_[SND_XFADE_STEPS + 1];
+        i32 xfade_buffers_[2][MIXER_BUFFER_SIZE];
         u32 samplerate_;
+        u32 channels_;
+        u32 mix_mode_;
+        i16* pull_buffer_;
+        i32 voice_buffer_[MIXER_BUFFER_SIZE];
+        i32 planar_[SND_MAX_CHANNELS][MIXER_BUFFER_SIZE / 2];     /* multichannel accumulators, one block per channel */
         i32 gain_;
+        // baked sounds
+        Sound* baked_;
+        u32 baked_count_;
+        u32 baked_rate_;
     };
 }
 #endif /*SOUND_PLAYER_H*/